@@ -4,7 +4,19 @@
 #include "hardware/gpio.h"
 #include "hardware/timer.h"
 #include "hardware/irq.h"
+#include "hardware/sync.h"
+#include "hardware/clocks.h"
+#include "hardware/structs/systick.h"
 #include "math.h"
+#include "ruido.h"
+
+#ifdef SIMULACION_HOST
+// En el backend de simulacion cada cambio de nivel del PWM que escribe timer_callback queda en un archivo VCD.
+// El nivel se lee una sola vez: duty_cycle es volatile.
+#include "vcd_trace.h"
+#define VCD_RUTA "generador_interr.vcd"
+#define pwm_set_chan_level(slice, canal, nivel) do { uint16_t nivel_vcd = (nivel); pwm_set_chan_level((slice), (canal), nivel_vcd); vcd_pwm(nivel_vcd); } while (0)
+#endif
 
 #define PWM_PIN 2 // Pin PWM
 
@@ -14,11 +26,141 @@
 
 volatile uint16_t duty_cycle = 0;
 
+// Forma generada por la interrupción: rampa, ruido blanco o ruido rosa. Se elige al compilar, p. ej. -DWAVEFORM=2
+#define WAVE_RAMP 0
+#define WAVE_WHITE_NOISE 1
+#define WAVE_PINK_NOISE 2
+#ifndef WAVEFORM
+#define WAVEFORM WAVE_RAMP
+#endif
+
+#if WAVEFORM != WAVE_RAMP
+#define NOISE_BLOCK 64 // Muestras de ruido por llamada a ruido_bloque
+
+ruido_t noise;
+uint8_t noise_block[NOISE_BLOCK];
+uint8_t noise_pos = NOISE_BLOCK;
+#endif
+
+// Contabilidad de carga de CPU por fuente de interrupcion.
+// Cada ISR marca entrada y salida con SysTick (ciclos de reloj, 24 bits hacia abajo, da la vuelta cada ~134 ms
+// a 125 MHz, de sobra para una ISR). Ademas el ciclo principal mide cuanto duerme en WFI: lo que no es sueño es
+// tiempo ocupado, y lo ocupado que no cae en ninguna fuente instrumentada (despacho del SDK, la IRQ de baja
+// prioridad del stdio USB, el propio reporte) se reporta aparte en vez de contarse como holgura.
+// Las fuentes tienen la misma prioridad y no se anidan; si se anidaran el tiempo se contaria dos veces.
+#define IRQ_SRC_TIMER 0
+#define IRQ_SRC_USB 1
+#define IRQ_NUM_SRC 2
+#define REPORT_INTERVAL_US 1000000 // Ventana de medicion y reporte
+
+const char *irq_src_names[IRQ_NUM_SRC] = {"Timer", "USB"};
+uint32_t sleep_cycles = 0; // Ciclos dormido en WFI en la ventana actual, solo lo toca el ciclo principal
+
+typedef struct {
+    uint32_t entry;        // SysTick al entrar a la ISR
+    uint32_t busy_cycles;  // Ciclos dentro de la ISR en la ventana actual
+    uint32_t count;        // Entradas en la ventana actual
+    uint32_t worst_cycles; // Peor duracion desde el arranque
+} irq_stats_t;
+
+volatile irq_stats_t irq_stats[IRQ_NUM_SRC];
+
+static inline void irq_stats_enter(uint src) {
+    irq_stats[src].entry = systick_hw->cvr;
+}
+
+static inline void irq_stats_exit(uint src) {
+    uint32_t cycles = (irq_stats[src].entry - systick_hw->cvr) & 0x00FFFFFF;
+    irq_stats[src].busy_cycles += cycles;
+    irq_stats[src].count++;
+    if (cycles > irq_stats[src].worst_cycles) {
+        irq_stats[src].worst_cycles = cycles;
+    }
+}
+
+// El manejador de USBCTRL_IRQ lo instala TinyUSB como compartido; estos dos lo envuelven. La parte que corra
+// antes de usb_irq_enter (otro manejador con la misma prioridad de orden) queda como no instrumentada.
+void usb_irq_enter() {
+    irq_stats_enter(IRQ_SRC_USB);
+}
+
+void usb_irq_exit() {
+    irq_stats_exit(IRQ_SRC_USB);
+}
+
+void irq_stats_init() {
+    systick_hw->rvr = 0x00FFFFFF;
+    systick_hw->cvr = 0;
+    systick_hw->csr = 0x5; // Habilitado, reloj del procesador, sin interrupcion
+    irq_add_shared_handler(USBCTRL_IRQ, usb_irq_enter, PICO_SHARED_IRQ_HANDLER_HIGHEST_ORDER_PRIORITY);
+    irq_add_shared_handler(USBCTRL_IRQ, usb_irq_exit, PICO_SHARED_IRQ_HANDLER_LOWEST_ORDER_PRIORITY);
+}
+
+// Duerme hasta la proxima interrupcion y suma el tiempo dormido. Con PRIMASK puesto WFI igual despierta con una
+// interrupcion pendiente, pero la ISR no corre hasta restaurar, asi el segundo SysTick no incluye la ISR.
+// Supone que siempre hay una interrupcion antes de ~134 ms (el timer llega cada 1/TIMER_FREQ).
+void idle_sleep() {
+    uint32_t irq_state = save_and_disable_interrupts();
+    uint32_t start = systick_hw->cvr;
+    __wfi();
+    uint32_t end = systick_hw->cvr;
+    restore_interrupts(irq_state);
+    sleep_cycles += (start - end) & 0x00FFFFFF;
+}
+
+// Imprime utilizacion por fuente, ocupado sin instrumentar, peor ISR, holgura real (tiempo en WFI) y hasta donde
+// se podria subir la frecuencia del timer. Se llama desde el ciclo principal, fuera de las interrupciones.
+void irq_stats_report(uint64_t window_us) {
+    irq_stats_t snapshot[IRQ_NUM_SRC];
+    uint32_t irq_state = save_and_disable_interrupts();
+    for (int i = 0; i < IRQ_NUM_SRC; i++) {
+        snapshot[i] = irq_stats[i];
+        irq_stats[i].busy_cycles = 0;
+        irq_stats[i].count = 0;
+    }
+    restore_interrupts(irq_state);
+    uint64_t idle = sleep_cycles;
+    sleep_cycles = 0;
+
+    uint32_t cycles_per_us = clock_get_hz(clk_sys) / 1000000;
+    uint64_t window_cycles = window_us * cycles_per_us;
+    if (idle > window_cycles) {
+        idle = window_cycles;
+    }
+    uint64_t busy = window_cycles - idle;
+    uint64_t instrumented = 0;
+    for (int i = 0; i < IRQ_NUM_SRC; i++) {
+        uint32_t load_permille = (uint32_t)((uint64_t)snapshot[i].busy_cycles * 1000 / window_cycles);
+        uint32_t avg_cycles = snapshot[i].count ? snapshot[i].busy_cycles / snapshot[i].count : 0;
+        printf("IRQ %s: %lu entradas, carga %lu.%lu %%, promedio %lu ciclos, peor %lu ciclos (%lu us)\n",
+            irq_src_names[i], snapshot[i].count, load_permille / 10, load_permille % 10, avg_cycles,
+            snapshot[i].worst_cycles, snapshot[i].worst_cycles / cycles_per_us);
+        instrumented += snapshot[i].busy_cycles;
+    }
+    uint64_t other = busy > instrumented ? busy - instrumented : 0;
+    uint32_t other_permille = (uint32_t)(other * 1000 / window_cycles);
+    printf("Sin instrumentar (ciclo principal, despacho, otras IRQ): carga %lu.%lu %%\n", other_permille / 10, other_permille % 10);
+
+    uint32_t expected = (uint32_t)(window_us * TIMER_FREQ / 1000000);
+    uint32_t missed = expected > snapshot[IRQ_SRC_TIMER].count ? expected - snapshot[IRQ_SRC_TIMER].count : 0;
+    uint32_t busy_permille = (uint32_t)(busy * 1000 / window_cycles);
+    // La ISR del timer puede crecer hasta ocupar la holgura; con la peor ISR encadenada es el limite duro
+    uint64_t timer_busy = snapshot[IRQ_SRC_TIMER].busy_cycles;
+    uint32_t max_freq_avg = timer_busy ? (uint32_t)((uint64_t)TIMER_FREQ * (timer_busy + idle) / timer_busy) : 0;
+    uint32_t max_freq_worst = snapshot[IRQ_SRC_TIMER].worst_cycles ? clock_get_hz(clk_sys) / snapshot[IRQ_SRC_TIMER].worst_cycles : 0;
+    printf("CPU: ocupada %lu.%lu %%, holgura %lu.%lu %%, muestras perdidas %lu, frecuencia maxima ~%lu Hz (peor caso %lu Hz)\n",
+        busy_permille / 10, busy_permille % 10, (1000 - busy_permille) / 10, (1000 - busy_permille) % 10,
+        missed, max_freq_avg, max_freq_worst);
+}
+
 void pwm_init() {
     gpio_set_function(PWM_PIN, GPIO_FUNC_PWM);
     pwm_set_wrap(pwm_gpio_to_slice_num(PWM_PIN), 1023); // Rango de 0 a 1023
     pwm_set_clkdiv(pwm_gpio_to_slice_num(PWM_PIN), 16.0f); // Divide la frecuencia base del sistema por 16
     pwm_set_enabled(pwm_gpio_to_slice_num(PWM_PIN), true); // Habilita el PWM
+#ifdef SIMULACION_HOST
+    vcd_pwm(duty_cycle); // Nivel de arranque, asi la traza no queda en x hasta la primera interrupcion
+#endif
 }
 
 void set_pwm_duty_cycle(uint16_t duty) {
@@ -26,19 +168,37 @@ void set_pwm_duty_cycle(uint16_t duty) {
 }
 
 void timer_callback() {
+    irq_stats_enter(IRQ_SRC_TIMER);
+#if WAVEFORM == WAVE_RAMP
     // Incrementar el ciclo de trabajo
     duty_cycle++;
     if (duty_cycle > 1023) {
         duty_cycle = 0;
     }
+#else
+    // El bloque se rellena cada NOISE_BLOCK interrupciones; esa ISR es la que marca el peor caso
+    if (noise_pos >= NOISE_BLOCK) {
+        ruido_bloque(&noise, noise_block, NOISE_BLOCK);
+        noise_pos = 0;
+    }
+    duty_cycle = (uint16_t)noise_block[noise_pos++] << 2; // 8 bits a la escala de 0 a 1023
+#endif
     pwm_set_chan_level(pwm_gpio_to_slice_num(PWM_PIN), pwm_gpio_to_channel(PWM_PIN), duty_cycle);
+    irq_stats_exit(IRQ_SRC_TIMER);
 }
 
 int main() {
     stdio_init_all();
     sleep_ms(2000); // Espera para establecer una conexión serial
+#ifdef SIMULACION_HOST
+    vcd_abrir(VCD_RUTA);
+#endif
 
     pwm_init();
+    irq_stats_init();
+#if WAVEFORM != WAVE_RAMP
+    ruido_iniciar(&noise, RUIDO_SEMILLA, WAVEFORM == WAVE_PINK_NOISE);
+#endif
 
     // Configurar e iniciar el temporizador
     uint32_t interval_us = 1000000 / TIMER_FREQ;
@@ -53,8 +213,15 @@ int main() {
     irq_set_enabled(TIMER_IRQ_0, true);
     __enable_irq();
 
+    uint64_t window_start = time_us_64();
     while (1) {
-        // El programa sigue funcionando, las señales se generan por la interrupción del temporizador
+        // Las señales se generan por la interrupción del temporizador; entre interrupciones el núcleo duerme
+        idle_sleep();
+        uint64_t now = time_us_64();
+        if (now - window_start >= REPORT_INTERVAL_US) {
+            irq_stats_report(now - window_start);
+            window_start = now;
+        }
     }
 
     return 0;
@@ -11,10 +11,24 @@
 
 #include "pico/stdlib.h"
 #include "hardware/gpio.h"
+#include "hardware/sync.h"
+#include "hardware/clocks.h"
+#include "hardware/structs/systick.h"
+#include "hardware/flash.h"
+#include "hardware/pwm.h"
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
+#include <stddef.h>
 #include <math.h>
+#include "ruido.h"
+
+#ifdef SIMULACION_HOST
+// En el backend de simulacion cada escritura de GPIO y cada byte del DAC quedan en un archivo VCD
+#include "vcd_trace.h"
+#define VCD_RUTA "generador_polling.vcd"
+#define gpio_put(pin, valor) do { gpio_put((pin), (valor)); vcd_gpio((pin), (valor)); } while (0)
+#endif
 
 """
 @brief Definición de los pines de control del DAC
@@ -33,6 +47,9 @@
  */
 
 void set_DAC_value(uint8_t value) {
+#ifdef SIMULACION_HOST
+    vcd_dac(value);
+#endif
     gpio_put(D0_PIN, (value & 0x01));
     gpio_put(D1_PIN, (value & 0x02));
     gpio_put(D2_PIN, (value & 0x04));
@@ -47,8 +64,41 @@ void set_DAC_value(uint8_t value) {
 
 
 //SEÑALES INDEPENDIENTES CON INDICE DE USO
-// Con el indice escojo que indice usar
-uint8_t indice_senal = 0;
+// La fase escoge el punto de la tabla: parte entera = indice, parte fraccionaria = avance hacia el siguiente punto
+
+/**
+ * @brief Fase de la señal en punto fijo Q16.16
+ *
+ * Los 16 bits altos son el indice dentro de la tabla (0 a PUNTOS_TABLA - 1) y los 16 bits bajos la
+ * fraccion entre ese punto y el siguiente. Con INTERP_NINGUNA la fraccion se ignora y el incremento
+ * es exactamente un punto por muestra, igual que el indice entero de antes.
+ */
+#define PUNTOS_TABLA 100
+#define FASE_FRAC_BITS 16
+#define FASE_UNO ((uint32_t)1 << FASE_FRAC_BITS)
+#define FASE_PERIODO ((uint32_t)PUNTOS_TABLA << FASE_FRAC_BITS)
+
+/**
+ * @brief Modos de reproduccion de la tabla
+ *
+ * El costo por muestra de cada modo en el equipo lo imprime medir_costo_fuentes al arrancar (ver esa
+ * medicion); aqui solo el trabajo de cada uno:
+ *  - INTERP_NINGUNA: una lectura de tabla, escalera de 100 escalones por periodo.
+ *  - INTERP_LINEAL:  dos lecturas y una multiplicacion.
+ *  - INTERP_CUBICA:  cuatro lecturas, Catmull-Rom por Horner (3 multiplicaciones) y saturacion.
+ * En los modos interpolados la muestra sale cada PERIODO_MUESTREO_INTERP_US sin importar la frecuencia,
+ * asi que el presupuesto es de 2500 ciclos por muestra a 125 MHz, a comparar con esa medicion. Por lo mismo la
+ * frecuencia queda limitada por Nyquist a menos de FRECUENCIA_MAX_INTERP; aplicar_lote rechaza lo que pase.
+ */
+#define INTERP_NINGUNA 0
+#define INTERP_LINEAL 1
+#define INTERP_CUBICA 2
+#define PERIODO_MUESTREO_INTERP_US 20 // 50 kHz fijos en los modos interpolados
+#define FRECUENCIA_MAX_INTERP (1000000 / (2 * PERIODO_MUESTREO_INTERP_US)) // 25 kHz, excluido
+
+uint32_t fase_senal = 0; // Fase actual Q16.16
+uint32_t incremento_fase = FASE_UNO; // Avance de fase por muestra Q16.16
+uint8_t modo_interpolacion = INTERP_NINGUNA;
 
 /**
  * @brief Función seno
@@ -131,41 +181,347 @@ const uint8_t sierra [] = {
 
 
 /**
- * @brief Asignación de los parametros a cada una de las señales
+ * @brief Lectura de la tabla en una fase fraccionaria
  *
- * Personalización de la señal luego de tener una entrada para alguno de los parámetros (Amplitud, frecuencia u offset)
+ * Interpola entre los puntos de la tabla usando solo aritmetica entera. La tabla es periodica, asi que
+ * los vecinos de los extremos se toman dando la vuelta.
+ *
+ * @param tabla: Tabla de PUNTOS_TABLA puntos de la señal.
+ * @param fase: Fase Q16.16, menor que FASE_PERIODO.
+ * @param modo: INTERP_NINGUNA, INTERP_LINEAL o INTERP_CUBICA.
+ * @return Valor de la señal en esa fase (0 a 255).
  */
+uint8_t muestra_interpolada(const uint8_t *tabla, uint32_t fase, uint8_t modo) {
+    uint32_t i1 = fase >> FASE_FRAC_BITS;
+    int32_t t = (int32_t)(fase & (FASE_UNO - 1));
+    uint32_t i2 = (i1 + 1 == PUNTOS_TABLA) ? 0 : i1 + 1;
+    int32_t p1 = tabla[i1];
+    int32_t p2 = tabla[i2];
 
-void generador_senal(uint8_t tipo, uint32_t Amplitud, uint32_t DC){
+    if (modo == INTERP_LINEAL) {
+        return (uint8_t)(p1 + (((p2 - p1) * t) >> FASE_FRAC_BITS));
+    }
+    if (modo == INTERP_CUBICA) {
+        int32_t p0 = tabla[(i1 == 0) ? PUNTOS_TABLA - 1 : i1 - 1];
+        int32_t p3 = tabla[(i2 + 1 == PUNTOS_TABLA) ? 0 : i2 + 1];
+        // Catmull-Rom: 2*y = a*t^3 + b*t^2 + c*t + 2*p1, |a| <= 8*255 asi que a*t cabe en 32 bits
+        int32_t a = -p0 + 3 * p1 - 3 * p2 + p3;
+        int32_t b = 2 * p0 - 5 * p1 + 4 * p2 - p3;
+        int32_t c = p2 - p0;
+        int32_t y = ((a * t) >> FASE_FRAC_BITS) + b;
+        y = ((y * t) >> FASE_FRAC_BITS) + c;
+        y = (((y * t) >> FASE_FRAC_BITS) + 2 * p1) >> 1;
+        if (y < 0) y = 0; //La cubica se pasa en los flancos de la cuadrada y la sierra
+        if (y > 255) y = 255;
+        return (uint8_t)y;
+    }
+    return (uint8_t)p1;
+}
+
+/**
+ * @brief Calculo de la temporizacion de muestreo
+ *
+ * Sin interpolacion se conserva el comportamiento original: un punto de la tabla por muestra y el periodo
+ * de muestreo ajustado a la frecuencia. Con interpolacion el periodo es fijo y lo que cambia es el avance
+ * de fase por muestra.
+ *
+ * @param frecuencia: Frecuencia de la señal en Hz.
+ * @param modo: Modo de interpolacion.
+ * @param periodo_us: Salida, tiempo entre muestras en us.
+ * @param incremento: Salida, avance de fase por muestra en Q16.16.
+ */
+void calcular_muestreo(uint32_t frecuencia, uint8_t modo, uint32_t *periodo_us, uint32_t *incremento) {
+    if (modo == INTERP_NINGUNA) {
+        *periodo_us = (uint32_t)((1000000.0)*(1.0/PUNTOS_TABLA)*(1.0/frecuencia));
+        *incremento = FASE_UNO;
+    } else {
+        *periodo_us = PERIODO_MUESTREO_INTERP_US;
+        *incremento = (uint32_t)(((uint64_t)frecuencia * FASE_PERIODO * PERIODO_MUESTREO_INTERP_US) / 1000000);
+    }
+}
+
+/**
+ * @brief Modos de disparo de la salida
+ *
+ * DISPARO_CONTINUO: la señal sale siempre (comportamiento original).
+ * DISPARO_COMPUERTA: la señal sale mientras el pin de disparo este en alto, arrancando en fase 0 en el flanco de subida.
+ * DISPARO_RAFAGA: cada flanco de subida arranca la señal en fase 0 y saca exactamente periodos_rafaga periodos.
+ */
+#define DISPARO_CONTINUO 0
+#define DISPARO_COMPUERTA 1
+#define DISPARO_RAFAGA 2
+#define TRIGGER_PIN 27 // Entrada de disparo externo
+
+volatile uint8_t modo_disparo = DISPARO_CONTINUO;
+volatile uint32_t periodos_rafaga = 1; // Periodos por disparo en modo rafaga
+volatile uint32_t periodos_restantes = 0; // Periodos que faltan de la rafaga en curso
+volatile bool salida_activa = true; // El ciclo principal solo saca muestras si esta en true
+volatile uint8_t valor_inicio_disparo = 0; // Muestra en fase 0 con los parametros actuales, la saca la interrupcion
+volatile bool disparo_pendiente = false; // La interrupcion arranco una rafaga y el ciclo principal debe resincronizarse
+volatile uint32_t instante_disparo_us = 0; // Tiempo del ultimo disparo, referencia para la siguiente muestra
+volatile uint32_t latencia_disparo_ciclos = 0; // Ultima latencia flanco -> primera muestra
+volatile uint32_t latencia_disparo_max_ciclos = 0; // Peor latencia observada
+volatile uint32_t disparos_sin_medir = 0; // Contador desbordado o pulso mas corto que la latencia, no entran en el maximo
+volatile uint32_t peor_irq_apagadas_us = 0; // Ventana mas larga con las interrupciones apagadas
+
+/**
+ * @brief Medicion del flanco de disparo por hardware
+ *
+ * GPIO 27 es la entrada B del slice 5 del PWM. En modo PWM_DIV_B_HIGH el contador del slice avanza un paso
+ * cada DIVISOR_FLANCO ciclos mientras el pin esta en alto, asi que leerlo justo despues de escribir el DAC
+ * da los ciclos desde el flanco de subida, incluida la entrada a la interrupcion, el despacho del SDK y
+ * cualquier tramo con las interrupciones apagadas. El contador se pone en 0 con el pin en bajo. Si da la
+ * vuelta (bandera de wrap del slice) la latencia pasa de 65536 * DIVISOR_FLANCO ciclos y solo se cuenta.
+ */
+#define DIVISOR_FLANCO 8 // Resolucion de 8 ciclos, rango de ~4.2 ms a 125 MHz
+
+/**
+ * @brief Secciones con las interrupciones apagadas
+ *
+ * Todo lo que corre aqui retrasa la interrupcion de disparo, asi que se mide y la peor ventana se reporta.
+ */
+uint32_t entrar_seccion_critica(uint32_t *inicio_us) {
+    uint32_t estado = save_and_disable_interrupts();
+    *inicio_us = time_us_32();
+    return estado;
+}
+
+void salir_seccion_critica(uint32_t estado, uint32_t inicio_us) {
+    uint32_t duracion = time_us_32() - inicio_us;
+    if (duracion > peor_irq_apagadas_us) {
+        peor_irq_apagadas_us = duracion;
+    }
+    restore_interrupts(estado);
+}
+const uint8_t *volatile tabla_escalada = NULL; // Tabla ya escalada de un preset; NULL = calcular cada muestra
+
+/**
+ * @brief Formas de ruido, despues de las cuatro tablas
+ *
+ * El ruido sale a la frecuencia de muestreo (100 * frecuencia sin interpolacion, 50 kHz con interpolacion);
+ * la fase sigue avanzando solo para contar periodos en modo rafaga.
+ */
+#define FORMA_RUIDO_BLANCO 4
+#define FORMA_RUIDO_ROSA 5
+#define NUM_FORMAS 6
+#define BLOQUE_RUIDO 64 // Muestras por llamada a ruido_bloque
+
+ruido_t ruido_blanco;
+ruido_t ruido_rosa;
+uint8_t bloque_ruido[BLOQUE_RUIDO];
+uint8_t pos_ruido = BLOQUE_RUIDO; // Vacio: se llena en la primera muestra
+uint8_t tipo_bloque_ruido = FORMA_RUIDO_BLANCO;
+
+/**
+ * @brief Escalado de una muestra a la amplitud y el offset pedidos
+ *
+ * @param valor_senal: Muestra de 8 bits de la tabla o del ruido.
+ * @param Amplitud: Amplitud en mV.
+ * @param DC: Offset en mV.
+ * @return Valor listo para el DAC.
+ */
+uint8_t escalar_muestra(uint16_t valor_senal, uint32_t Amplitud, uint32_t DC){
     Amplitud /= 2;
-    uint16_t valor_senal;
+    //ojo, Se NORMALIZAN los datos aquí
+    uint16_t normalizado_DC = 255 - ((DC * 255) / 1250); //Offset norm
+    uint16_t normalizado_Amplitud = 2500 / Amplitud; //Amplitud norm
+    valor_senal = (valor_senal / normalizado_Amplitud) - normalizado_DC;
+    return (uint8_t)valor_senal;
+}
+
+/**
+ * @brief Calculo de una muestra de la señal
+ *
+ * Personalización de la señal luego de tener una entrada para alguno de los parámetros (Amplitud, frecuencia u offset)
+ *
+ * @param tipo: Forma de onda (0 seno, 1 triangular, 2 sierra, 3 cuadrada, 4 ruido blanco, 5 ruido rosa).
+ * @param Amplitud: Amplitud en mV.
+ * @param DC: Offset en mV.
+ * @param fase: Fase Q16.16 de la muestra.
+ * @return Valor listo para el DAC.
+ */
+uint8_t calcular_muestra(uint8_t tipo, uint32_t Amplitud, uint32_t DC, uint32_t fase){
+    const uint8_t *tabla = seno;
 
     switch (tipo)
     {
     case 0:
-        valor_senal = seno[indice_senal];
+        tabla = seno;
         break;
     case 1: 
-        valor_senal = triangular[indice_senal];
+        tabla = triangular;
         break;
     case 2:
-        valor_senal = sierra[indice_senal];
+        tabla = sierra;
         break;
     case 3:
-        valor_senal = cuadrada[indice_senal];
+        tabla = cuadrada;
         break;
+    case FORMA_RUIDO_BLANCO:
+    case FORMA_RUIDO_ROSA:
+        return escalar_muestra(128, Amplitud, DC); //El ruido no tiene fase, se toma el nivel medio
     
     default:
         break;
     }
+    return escalar_muestra(muestra_interpolada(tabla, fase, modo_interpolacion), Amplitud, DC);
+}
 
-    //ojo, Se NORMALIZAN los datos aquí
-    uint16_t normalizado_DC = 255 - ((DC * 255) / 1250); //Offset norm
-    uint16_t normalizado_Amplitud = 2500 / Amplitud; //Amplitud norm
-    valor_senal = (valor_senal / normalizado_Amplitud) - normalizado_DC; //Manda la senal personalziada al DAC
-    set_DAC_value(valor_senal);
-    indice_senal += 1; //cambio de indice
-    indice_senal %= 100;
+/**
+ * @brief Siguiente muestra de ruido
+ *
+ * Las muestras salen de un bloque que se vuelve a llenar con ruido_bloque al agotarse o al cambiar de blanco
+ * a rosa, asi el costo del generador se reparte en bloques como si llenara un buffer de DMA.
+ *
+ * @param tipo: FORMA_RUIDO_BLANCO o FORMA_RUIDO_ROSA.
+ * @return Muestra de 8 bits sin escalar (128 = cero).
+ */
+uint8_t siguiente_ruido(uint8_t tipo) {
+    if (pos_ruido >= BLOQUE_RUIDO || tipo != tipo_bloque_ruido) {
+        ruido_bloque(tipo == FORMA_RUIDO_ROSA ? &ruido_rosa : &ruido_blanco, bloque_ruido, BLOQUE_RUIDO);
+        tipo_bloque_ruido = tipo;
+        pos_ruido = 0;
+    }
+    return bloque_ruido[pos_ruido++];
+}
+
+/**
+ * @brief Avance de la fase
+ *
+ * En modo rafaga cuenta las vueltas de la fase y apaga la salida al completar los periodos pedidos, dejando
+ * el DAC en el valor de fase 0. El avance va en 64 bits para poder saltar de una vez muchas muestras atrasadas.
+ *
+ * @param avance: Avance de fase Q16.16.
+ */
+void avanzar_fase(uint64_t avance) {
+    uint64_t fase = fase_senal + avance;
+    if (fase >= FASE_PERIODO) {
+        uint64_t vueltas = fase / FASE_PERIODO;
+        fase %= FASE_PERIODO;
+        if (modo_disparo == DISPARO_RAFAGA) {
+            if (vueltas >= periodos_restantes) {
+                periodos_restantes = 0;
+                salida_activa = false;
+                set_DAC_value(valor_inicio_disparo);
+            } else {
+                periodos_restantes -= (uint32_t)vueltas;
+            }
+        }
+    }
+    fase_senal = (uint32_t)fase;
+}
+
+/**
+ * @brief Siguiente muestra de la señal
+ *
+ * Calcula la muestra de la fase actual (ruido, tabla de preset o tabla escalada al vuelo) y avanza la fase una
+ * muestra. Es todo lo que hace generador_senal salvo escribir el DAC.
+ *
+ * @return Valor listo para el DAC.
+ */
+uint8_t siguiente_muestra(uint8_t tipo, uint32_t Amplitud, uint32_t DC){
+    uint8_t valor;
+    if (tipo == FORMA_RUIDO_BLANCO || tipo == FORMA_RUIDO_ROSA) {
+        valor = escalar_muestra(siguiente_ruido(tipo), Amplitud, DC);
+    } else if (tabla_escalada != NULL) {
+        valor = muestra_interpolada(tabla_escalada, fase_senal, modo_interpolacion); //Preset: la tabla ya tiene amplitud y offset
+    } else {
+        valor = calcular_muestra(tipo, Amplitud, DC, fase_senal); //Senal personalizada
+    }
+    avanzar_fase(incremento_fase); //cambio de fase
+    return valor;
+}
+
+/**
+ * @brief Asignación de los parametros a cada una de las señales
+ *
+ * Saca la muestra de la fase actual al DAC y avanza la fase una muestra.
+ */
+
+void generador_senal(uint8_t tipo, uint32_t Amplitud, uint32_t DC){
+    set_DAC_value(siguiente_muestra(tipo, Amplitud, DC));
+}
+
+/**
+ * @brief Interrupcion del pin de disparo
+ *
+ * En el flanco de subida (modos compuerta y rafaga) pone la fase en 0 y saca la primera muestra desde la
+ * propia interrupcion, asi la latencia no depende de en que parte del ciclo principal se este. La peor
+ * latencia es la entrada a la interrupcion mas la seccion critica mas larga del ciclo principal
+ * (peor_irq_apagadas_us), que incluye el borrado de flash al guardar un preset.
+ *
+ * La latencia se toma del contador del PWM que arranca con el flanco (ver DIVISOR_FLANCO), no del cuerpo
+ * de esta funcion.
+ *
+ * @param gpio: Pin que genero el evento.
+ * @param events: Flancos detectados.
+ */
+void disparo_callback(uint gpio, uint32_t events) {
+    uint slice = pwm_gpio_to_slice_num(TRIGGER_PIN);
+    if (gpio != TRIGGER_PIN) {
+        return;
+    }
+    // En continuo el slice sigue contando mientras el pin esta en alto; el flanco de bajada se atiende igual
+    // (abajo) para que el primer disparo despues de cambiar de modo no herede ese tiempo como latencia
+    if (modo_disparo != DISPARO_CONTINUO) {
+        if (events & GPIO_IRQ_EDGE_RISE) {
+            set_DAC_value(valor_inicio_disparo);
+            uint32_t pasos = pwm_get_counter(slice);
+            bool desbordado = (pwm_hw->intr & (1u << slice)) != 0;
+            bool pulso_corto = !gpio_get(TRIGGER_PIN); //El contador se paro al bajar el pin, solo mide el ancho del pulso
+            periodos_restantes = periodos_rafaga;
+            salida_activa = true;
+            // La muestra de fase 0 ya salio. El avance puede pasar de un periodo (interpolado a alta frecuencia):
+            // se reduce y se cuentan las vueltas igual que en el generador
+            fase_senal = 0;
+            avanzar_fase(incremento_fase);
+            instante_disparo_us = time_us_32();
+            disparo_pendiente = true;
+            if (desbordado || pulso_corto) {
+                disparos_sin_medir++;
+            } else {
+                latencia_disparo_ciclos = pasos * DIVISOR_FLANCO;
+                if (latencia_disparo_ciclos > latencia_disparo_max_ciclos) {
+                    latencia_disparo_max_ciclos = latencia_disparo_ciclos;
+                }
+            }
+        }
+        // Un pulso corto puede llegar con los dos flancos juntos si las interrupciones estaban apagadas; en
+        // compuerta manda el nivel actual del pin, no el orden de los eventos
+        if (modo_disparo == DISPARO_COMPUERTA && !gpio_get(TRIGGER_PIN)) {
+            salida_activa = false;
+            set_DAC_value(valor_inicio_disparo);
+        }
+    }
+    if (events & GPIO_IRQ_EDGE_FALL) {
+        // Con el pin en bajo el contador esta quieto: se deja en 0 para el proximo flanco
+        pwm_set_counter(slice, 0);
+        pwm_clear_irq(slice);
+    }
+}
+
+/**
+ * @brief Configuracion del pin de disparo y del contador de ciclos
+ */
+void configurar_disparo() {
+    systick_hw->rvr = 0x00FFFFFF;
+    systick_hw->cvr = 0;
+    systick_hw->csr = 0x5; //Habilitado, reloj del procesador, sin interrupcion
+    gpio_init(TRIGGER_PIN);
+    gpio_set_dir(TRIGGER_PIN, GPIO_IN);
+    gpio_pull_down(TRIGGER_PIN);
+    // El pin pasa a la funcion PWM para que el slice cuente mientras esta en alto; la interrupcion por
+    // flanco y gpio_get leen el pad igual
+    uint slice = pwm_gpio_to_slice_num(TRIGGER_PIN);
+    pwm_config config_flanco = pwm_get_default_config();
+    pwm_config_set_clkdiv_mode(&config_flanco, PWM_DIV_B_HIGH);
+    pwm_config_set_clkdiv_int(&config_flanco, DIVISOR_FLANCO);
+    pwm_config_set_wrap(&config_flanco, 0xFFFF);
+    pwm_init(slice, &config_flanco, true);
+    pwm_set_counter(slice, 0);
+    pwm_clear_irq(slice);
+    gpio_set_function(TRIGGER_PIN, GPIO_FUNC_PWM);
+    gpio_set_irq_enabled_with_callback(TRIGGER_PIN, GPIO_IRQ_EDGE_RISE | GPIO_IRQ_EDGE_FALL, true, &disparo_callback);
 }
 
 /**
@@ -235,6 +591,613 @@ void asignar_pines() {
     }
 }
 
+/**
+ * @brief Medicion del costo por muestra de cada fuente
+ *
+ * Se corre una vez al arrancar, con SysTick ya configurado y antes de elegir una señal (modo continuo, sin
+ * preset). Mide la tabla en los tres modos de interpolacion y los dos ruidos. Cada fuente pasa por siguiente_muestra, el mismo camino de generador_senal: tabla con escalado y
+ * avance de fase, o ruido con escalado y el rellenado del bloque cada BLOQUE_RUIDO muestras. Solo queda
+ * fuera set_DAC_value, que cuesta igual para todas las formas.
+ */
+#define MUESTRAS_MEDICION 1024 // Multiplo de BLOQUE_RUIDO: cada medicion de ruido incluye los mismos rellenados
+#define FUENTES_MEDICION 5
+
+void medir_costo_fuentes() {
+    const uint8_t tipos[FUENTES_MEDICION] = {0, 0, 0, FORMA_RUIDO_BLANCO, FORMA_RUIDO_ROSA};
+    const uint8_t interp[FUENTES_MEDICION] = {INTERP_NINGUNA, INTERP_LINEAL, INTERP_CUBICA, INTERP_NINGUNA, INTERP_NINGUNA};
+    volatile uint32_t sumidero; //Evita que el compilador quite los bucles
+    uint32_t ciclos[FUENTES_MEDICION];
+    uint32_t fase_guardada = fase_senal;
+    uint32_t incremento_guardado = incremento_fase;
+    uint8_t interp_guardada = modo_interpolacion;
+    incremento_fase = FASE_UNO + (FASE_UNO >> 2); //1.25 puntos por muestra: la interpolacion no es trivial
+    uint32_t estado_irq = save_and_disable_interrupts();
+    for (int f = 0; f < FUENTES_MEDICION; f++) {
+        modo_interpolacion = interp[f];
+        fase_senal = 0;
+        pos_ruido = BLOQUE_RUIDO; //Bloque vacio: el primer rellenado entra en la cuenta
+        uint32_t suma = 0;
+        uint32_t inicio = systick_hw->cvr;
+        for (int i = 0; i < MUESTRAS_MEDICION; i++) {
+            suma += siguiente_muestra(tipos[f], 1000, 100);
+        }
+        ciclos[f] = (inicio - systick_hw->cvr) & 0x00FFFFFF;
+        sumidero = suma;
+    }
+    restore_interrupts(estado_irq);
+    (void)sumidero;
+    fase_senal = fase_guardada;
+    incremento_fase = incremento_guardado;
+    modo_interpolacion = interp_guardada;
+    pos_ruido = BLOQUE_RUIDO;
+    const char *nombres[FUENTES_MEDICION] = {"Tabla", "Tabla lineal", "Tabla cubica", "Ruido blanco", "Ruido rosa"};
+    for (int i = 0; i < FUENTES_MEDICION; i++) {
+        uint32_t centesimas = ciclos[i] * 100 / MUESTRAS_MEDICION;
+        printf("Costo por muestra: %s -> %d.%02d ciclos\n", nombres[i], centesimas / 100, centesimas % 100);
+    }
+}
+
+/**
+ * @brief Configuracion completa de la señal
+ *
+ * Los cambios del teclado y del puerto serie se acumulan en una copia y se aplican todos juntos al confirmar.
+ */
+typedef struct {
+    uint8_t tipo; // 0 seno, 1 triangular, 2 sierra, 3 cuadrada, 4 ruido blanco, 5 ruido rosa
+    uint32_t amplitud; // mV
+    uint32_t offset; // mV
+    uint32_t frecuencia; // Hz
+    uint8_t interpolacion; // INTERP_NINGUNA, INTERP_LINEAL o INTERP_CUBICA
+    uint8_t disparo; // DISPARO_CONTINUO, DISPARO_COMPUERTA o DISPARO_RAFAGA
+    uint32_t periodos; // Periodos por rafaga
+    uint32_t periodo_us; // Derivado: tiempo entre muestras
+} configuracion_senal_t;
+
+/**
+ * @brief Presets guardados en flash
+ *
+ * Los presets viven en el ultimo sector de la flash, lejos del programa. Al arrancar se copian a RAM y se
+ * revisa la suma de verificacion; si no coincide se arranca sin presets. Borrar y programar el sector toma
+ * decenas de ms con las interrupciones apagadas, asi que guardar un preset detiene la salida ese tiempo.
+ */
+#define NUM_PRESETS 10 // Presets 0 a 9
+#define PRESETS_FLASH_OFFSET (PICO_FLASH_SIZE_BYTES - FLASH_SECTOR_SIZE)
+#define PRESETS_MAGICA 0x50524553 // "PRES"
+#define PRESETS_VERSION 1
+
+typedef struct {
+    uint32_t magica;
+    uint32_t version;
+    uint8_t ocupado[NUM_PRESETS];
+    configuracion_senal_t presets[NUM_PRESETS];
+    uint32_t suma; // FNV-1a de todo lo anterior
+} presets_flash_t;
+
+/**
+ * @brief Cache en RAM de tablas ya escaladas
+ *
+ * Cada entrada tiene la tabla de la forma de onda con la amplitud y el offset aplicados y el avance de fase,
+ * de modo que recuperar un preset que esta en la cache es solo cambiar punteros. Se reemplaza la entrada
+ * usada hace mas tiempo, nunca la que esta sonando. Los presets de ruido no entran: su muestra no depende de
+ * la fase y una tabla constante solo le quitaria el lugar a un preset de tabla.
+ */
+#define CACHE_PRESETS 4
+
+typedef struct {
+    int8_t preset; // -1 = entrada libre
+    uint32_t uso; // Marca de tiempo LRU
+    configuracion_senal_t config;
+    uint32_t incremento;
+    uint8_t tabla[PUNTOS_TABLA];
+} entrada_cache_t;
+
+presets_flash_t presets_guardados;
+entrada_cache_t cache_presets[CACHE_PRESETS];
+uint32_t reloj_cache = 0;
+
+uint32_t suma_presets(const presets_flash_t *p) {
+    const uint8_t *bytes = (const uint8_t *)p;
+    uint32_t suma = 2166136261u;
+    for (size_t i = 0; i < offsetof(presets_flash_t, suma); i++) {
+        suma = (suma ^ bytes[i]) * 16777619u;
+    }
+    return suma;
+}
+
+/**
+ * @brief Devuelve la entrada de cache de un preset, escalando la tabla si no estaba
+ *
+ * @param preset: Numero de preset.
+ * @return La entrada, o NULL si el preset esta vacio o es de ruido.
+ */
+entrada_cache_t *cache_preset(uint8_t preset) {
+    if (preset >= NUM_PRESETS || !presets_guardados.ocupado[preset]) {
+        return NULL;
+    }
+    uint8_t tipo = presets_guardados.presets[preset].tipo;
+    if (tipo == FORMA_RUIDO_BLANCO || tipo == FORMA_RUIDO_ROSA) {
+        return NULL;
+    }
+    entrada_cache_t *victima = NULL;
+    for (int i = 0; i < CACHE_PRESETS; i++) {
+        entrada_cache_t *e = &cache_presets[i];
+        if (e->preset == preset) {
+            e->uso = ++reloj_cache;
+            return e;
+        }
+        if (e->tabla == tabla_escalada) {
+            continue; // Esta sonando
+        }
+        if (victima == NULL || e->preset < 0 || (victima->preset >= 0 && e->uso < victima->uso)) {
+            victima = e;
+        }
+    }
+
+    const configuracion_senal_t *c = &presets_guardados.presets[preset];
+    victima->preset = preset;
+    victima->uso = ++reloj_cache;
+    victima->config = *c;
+    uint32_t periodo;
+    calcular_muestreo(c->frecuencia, c->interpolacion, &periodo, &victima->incremento);
+    for (int i = 0; i < PUNTOS_TABLA; i++) {
+        // En fase entera todos los modos de interpolacion devuelven el punto de la tabla
+        victima->tabla[i] = calcular_muestra(c->tipo, c->amplitud, c->offset, (uint32_t)i << FASE_FRAC_BITS);
+    }
+    return victima;
+}
+
+/**
+ * @brief Lee los presets de la flash y deja en cache los primeros de tabla que quepan
+ */
+void cargar_presets() {
+    const presets_flash_t *flash = (const presets_flash_t *)(XIP_BASE + PRESETS_FLASH_OFFSET);
+    if (flash->magica == PRESETS_MAGICA && flash->version == PRESETS_VERSION && flash->suma == suma_presets(flash)) {
+        presets_guardados = *flash;
+    } else {
+        memset(&presets_guardados, 0, sizeof(presets_guardados));
+        presets_guardados.magica = PRESETS_MAGICA;
+        presets_guardados.version = PRESETS_VERSION;
+    }
+    for (int i = 0; i < CACHE_PRESETS; i++) {
+        cache_presets[i].preset = -1;
+    }
+    for (int i = 0, n = 0; i < NUM_PRESETS && n < CACHE_PRESETS; i++) {
+        if (cache_preset(i) != NULL) {
+            n++;
+        }
+    }
+}
+
+/**
+ * @brief Guarda una configuracion en un preset y la deja lista en cache
+ */
+void guardar_preset(uint8_t preset, const configuracion_senal_t *config) {
+    static uint8_t pagina[(sizeof(presets_flash_t) + FLASH_PAGE_SIZE - 1) / FLASH_PAGE_SIZE * FLASH_PAGE_SIZE];
+
+    presets_guardados.presets[preset] = *config;
+    presets_guardados.ocupado[preset] = 1;
+    presets_guardados.suma = suma_presets(&presets_guardados);
+    memset(pagina, 0xFF, sizeof(pagina));
+    memcpy(pagina, &presets_guardados, sizeof(presets_guardados));
+
+    uint32_t inicio_irq;
+    uint32_t estado_irq = entrar_seccion_critica(&inicio_irq);
+    for (int i = 0; i < CACHE_PRESETS; i++) {
+        if (cache_presets[i].preset == preset) {
+            if (cache_presets[i].tabla == tabla_escalada) {
+                tabla_escalada = NULL; // La configuracion vigente sigue igual, se calcula muestra a muestra
+            }
+            cache_presets[i].preset = -1;
+        }
+    }
+    flash_range_erase(PRESETS_FLASH_OFFSET, FLASH_SECTOR_SIZE);
+    flash_range_program(PRESETS_FLASH_OFFSET, pagina, sizeof(pagina));
+    salir_seccion_critica(estado_irq, inicio_irq);
+
+    cache_preset(preset);
+    printf("Preset %d guardado\n", preset);
+}
+
+/**
+ * @brief Parametros que entiende el analizador de comandos
+ */
+#define PARAM_NINGUNO 0
+#define PARAM_AMPLITUD 1
+#define PARAM_OFFSET 2
+#define PARAM_FRECUENCIA 3
+#define PARAM_FORMA 4
+#define PARAM_INTERPOLACION 5
+#define PARAM_DISPARO 6
+#define PARAM_RECUPERAR 7 // Carga un preset como base del lote
+#define PARAM_GUARDAR 8 // Guarda el resultado del lote en un preset
+
+#define ANALIZADOR_MNEMONICO 0 // Leyendo el nombre del comando (solo serie)
+#define ANALIZADOR_VALOR 1 // Leyendo el argumento
+#define ANALIZADOR_ERROR 2 // Se descarta todo hasta el fin del lote
+
+#define LARGO_MNEMONICO 4 // Forma corta SCPI, las letras de mas se ignoran
+#define MAX_DIGITOS 9 // Igual que el limite de texto del teclado, cabe en 32 bits
+#define PALABRA_SIN_VALOR 0xFFFFFFFF // La palabra equivale a no dar argumento
+
+/**
+ * @brief Estado del analizador incremental
+ *
+ * No hay buffer de texto: los digitos se acumulan directamente en valor y las letras en un mnemonico de
+ * cuatro caracteres. Cada parametro cerrado se valida y se escribe en pendiente; el lote se aplica entero
+ * o se descarta entero.
+ */
+typedef struct {
+    uint8_t estado;
+    uint8_t parametro;
+    char letras[LARGO_MNEMONICO];
+    uint8_t num_letras;
+    uint8_t num_digitos;
+    uint32_t valor;
+    uint16_t cambios; // Bit (1 << PARAM_x) por cada parametro del lote
+    uint8_t preset_recuperar;
+    uint8_t preset_guardar;
+    configuracion_senal_t pendiente;
+} analizador_t;
+
+typedef struct {
+    char texto[LARGO_MNEMONICO + 1];
+    uint8_t parametro;
+    uint32_t valor;
+} palabra_scpi_t;
+
+// Comandos SCPI: "FREQ 1000;AMPL 2000;SHAP SIN" y fin de linea para confirmar
+const palabra_scpi_t comandos_scpi[] = {
+    {"AMPL", PARAM_AMPLITUD, 0},
+    {"OFFS", PARAM_OFFSET, 0},
+    {"FREQ", PARAM_FRECUENCIA, 0},
+    {"SHAP", PARAM_FORMA, 0},
+    {"INTE", PARAM_INTERPOLACION, 0},
+    {"TRIG", PARAM_DISPARO, 0},
+    {"*RCL", PARAM_RECUPERAR, 0},
+    {"*SAV", PARAM_GUARDAR, 0},
+};
+
+// Argumentos con nombre, se reconocen por prefijo ("SQUARE" -> "SQU")
+const palabra_scpi_t argumentos_scpi[] = {
+    {"SIN", PARAM_FORMA, 0},
+    {"TRI", PARAM_FORMA, 1},
+    {"SAW", PARAM_FORMA, 2},
+    {"SQU", PARAM_FORMA, 3},
+    {"NOIS", PARAM_FORMA, FORMA_RUIDO_BLANCO},
+    {"WHIT", PARAM_FORMA, FORMA_RUIDO_BLANCO},
+    {"PINK", PARAM_FORMA, FORMA_RUIDO_ROSA},
+    {"NONE", PARAM_INTERPOLACION, INTERP_NINGUNA},
+    {"LIN", PARAM_INTERPOLACION, INTERP_LINEAL},
+    {"CUB", PARAM_INTERPOLACION, INTERP_CUBICA},
+    {"CONT", PARAM_DISPARO, PALABRA_SIN_VALOR},
+    {"GATE", PARAM_DISPARO, 0},
+};
+
+/**
+ * @brief Busca las letras leidas en una tabla de palabras
+ * @return La entrada encontrada o NULL.
+ */
+const palabra_scpi_t *buscar_palabra(const analizador_t *a, const palabra_scpi_t *tabla, int n, uint8_t parametro) {
+    for (int i = 0; i < n; i++) {
+        if (parametro != PARAM_NINGUNO && tabla[i].parametro != parametro) {
+            continue;
+        }
+        int k = 0;
+        while (k < LARGO_MNEMONICO && tabla[i].texto[k] != '\0' && k < a->num_letras && tabla[i].texto[k] == a->letras[k]) {
+            k++;
+        }
+        if (k > 0 && (k == LARGO_MNEMONICO || tabla[i].texto[k] == '\0')) {
+            return &tabla[i];
+        }
+    }
+    return NULL;
+}
+
+/**
+ * @brief Empieza un lote nuevo a partir de la configuracion vigente
+ */
+void analizador_reiniciar(analizador_t *a, const configuracion_senal_t *actual, uint8_t estado) {
+    a->estado = estado;
+    a->parametro = PARAM_NINGUNO;
+    a->num_letras = 0;
+    a->num_digitos = 0;
+    a->valor = 0;
+    a->cambios = 0;
+    a->pendiente = *actual;
+}
+
+/**
+ * @brief Valida el parametro en curso y lo deja en la configuracion pendiente
+ */
+void analizador_cerrar_parametro(analizador_t *a) {
+    if (a->estado == ANALIZADOR_ERROR || a->parametro == PARAM_NINGUNO) {
+        return;
+    }
+    bool hay_valor = a->num_digitos > 0;
+    uint32_t valor = a->valor;
+    if (a->num_letras > 0) {
+        const palabra_scpi_t *arg = buscar_palabra(a, argumentos_scpi, sizeof(argumentos_scpi) / sizeof(argumentos_scpi[0]), a->parametro);
+        if (arg == NULL || hay_valor) {
+            printf("Argumento invalido\n");
+            a->estado = ANALIZADOR_ERROR;
+            return;
+        }
+        hay_valor = arg->valor != PALABRA_SIN_VALOR;
+        valor = arg->valor;
+    }
+
+    bool valido = hay_valor;
+    switch (a->parametro) {
+    case PARAM_AMPLITUD:
+        valido = valido && 100 <= valor && valor <= 2500;
+        a->pendiente.amplitud = valor;
+        break;
+    case PARAM_OFFSET:
+        valido = valido && 50 <= valor && valor <= 1250;
+        a->pendiente.offset = valor;
+        break;
+    case PARAM_FRECUENCIA:
+        valido = valido && 1 <= valor && valor <= 12000000;
+        a->pendiente.frecuencia = valor;
+        break;
+    case PARAM_FORMA:
+        valido = valido && valor < NUM_FORMAS;
+        a->pendiente.tipo = valor;
+        break;
+    case PARAM_INTERPOLACION:
+        valido = valido && valor <= INTERP_CUBICA;
+        a->pendiente.interpolacion = valor;
+        break;
+    case PARAM_DISPARO:
+        // Sin argumento continuo, 0 compuerta, N rafaga de N periodos
+        valido = true;
+        if (!hay_valor) {
+            a->pendiente.disparo = DISPARO_CONTINUO;
+        } else if (valor == 0) {
+            a->pendiente.disparo = DISPARO_COMPUERTA;
+        } else {
+            a->pendiente.disparo = DISPARO_RAFAGA;
+            a->pendiente.periodos = valor;
+        }
+        break;
+    case PARAM_RECUPERAR:
+        valido = valido && valor < NUM_PRESETS;
+        a->preset_recuperar = valor;
+        break;
+    case PARAM_GUARDAR:
+        valido = valido && valor < NUM_PRESETS;
+        a->preset_guardar = valor;
+        break;
+    default:
+        break;
+    }
+    if (!valido) {
+        printf("Configuracion invalida para el parametro %d\n", a->parametro);
+        a->estado = ANALIZADOR_ERROR;
+        return;
+    }
+    a->cambios |= 1 << a->parametro;
+    a->parametro = PARAM_NINGUNO;
+}
+
+/**
+ * @brief Cierra el parametro anterior y empieza a leer el argumento de otro
+ */
+void analizador_parametro(analizador_t *a, uint8_t parametro) {
+    analizador_cerrar_parametro(a);
+    if (a->estado == ANALIZADOR_ERROR) {
+        return;
+    }
+    a->parametro = parametro;
+    a->estado = ANALIZADOR_VALOR;
+    a->num_letras = 0;
+    a->num_digitos = 0;
+    a->valor = 0;
+}
+
+/**
+ * @brief Acumula un digito del argumento
+ */
+void analizador_digito(analizador_t *a, char c) {
+    if (a->estado != ANALIZADOR_VALOR || a->parametro == PARAM_NINGUNO) {
+        if (a->estado != ANALIZADOR_ERROR) {
+            printf("Digito sin parametro\n");
+        }
+        a->estado = ANALIZADOR_ERROR;
+        return;
+    }
+    if (a->num_digitos >= MAX_DIGITOS) {
+        printf("Texto demasiado largo. Presione 'D' para finalizar.\n");
+        a->estado = ANALIZADOR_ERROR;
+        return;
+    }
+    a->valor = a->valor * 10 + (uint32_t)(c - '0');
+    a->num_digitos++;
+}
+
+/**
+ * @brief Entrada desde el teclado matricial
+ *
+ * A amplitud, B offset, C frecuencia, # interpolacion, * disparo, D confirma. Se pueden encadenar varios
+ * parametros antes de la D ("A2000C500D") y se aplican juntos. Digitos sin letra recuperan un preset ("3D").
+ *
+ * @return true cuando el lote esta listo para aplicar.
+ */
+bool analizador_tecla(analizador_t *a, char tecla) {
+    switch (tecla) {
+    case 'A': analizador_parametro(a, PARAM_AMPLITUD); break;
+    case 'B': analizador_parametro(a, PARAM_OFFSET); break;
+    case 'C': analizador_parametro(a, PARAM_FRECUENCIA); break;
+    case '#': analizador_parametro(a, PARAM_INTERPOLACION); break;
+    case '*': analizador_parametro(a, PARAM_DISPARO); break;
+    case 'D':
+        analizador_cerrar_parametro(a);
+        return true;
+    default:
+        if (a->parametro == PARAM_NINGUNO && a->estado == ANALIZADOR_VALOR && a->cambios == 0) {
+            analizador_parametro(a, PARAM_RECUPERAR);
+        }
+        analizador_digito(a, tecla);
+        break;
+    }
+    return false;
+}
+
+/**
+ * @brief Entrada desde el puerto serie con sintaxis tipo SCPI
+ *
+ * "MNEM arg" separados por ';' y confirmados con fin de linea, por ejemplo "FREQ 1000;AMPL 2000;SHAP SIN".
+ * No distingue mayusculas de minusculas.
+ *
+ * @return true cuando el lote esta listo para aplicar.
+ */
+bool analizador_caracter(analizador_t *a, char c) {
+    if (c >= 'a' && c <= 'z') {
+        c -= 'a' - 'A';
+    }
+    if (c == '\n' || c == '\r') {
+        if (a->estado == ANALIZADOR_MNEMONICO && a->num_letras == 0 && a->cambios == 0) {
+            return false; // Linea vacia o el '\n' de un "\r\n"
+        }
+        if (a->estado == ANALIZADOR_MNEMONICO && a->num_letras > 0) {
+            printf("Comando sin argumento\n");
+            a->estado = ANALIZADOR_ERROR;
+        }
+        analizador_cerrar_parametro(a);
+        return true;
+    }
+    if (a->estado == ANALIZADOR_ERROR) {
+        return false;
+    }
+    if (c == ';') {
+        if (a->estado == ANALIZADOR_MNEMONICO) {
+            printf("Comando sin argumento\n");
+            a->estado = ANALIZADOR_ERROR;
+            return false;
+        }
+        analizador_cerrar_parametro(a);
+        if (a->estado != ANALIZADOR_ERROR) {
+            a->estado = ANALIZADOR_MNEMONICO;
+            a->num_letras = 0;
+        }
+        return false;
+    }
+    if (c == ' ') {
+        if (a->estado == ANALIZADOR_MNEMONICO && a->num_letras > 0) {
+            const palabra_scpi_t *cmd = buscar_palabra(a, comandos_scpi, sizeof(comandos_scpi) / sizeof(comandos_scpi[0]), PARAM_NINGUNO);
+            if (cmd == NULL) {
+                printf("Comando desconocido\n");
+                a->estado = ANALIZADOR_ERROR;
+                return false;
+            }
+            analizador_parametro(a, cmd->parametro);
+        }
+        return false;
+    }
+    if (c >= '0' && c <= '9' && a->estado == ANALIZADOR_VALOR) {
+        if (a->num_letras > 0) {
+            printf("Argumento invalido\n");
+            a->estado = ANALIZADOR_ERROR;
+            return false;
+        }
+        analizador_digito(a, c);
+        return false;
+    }
+    if ((c >= 'A' && c <= 'Z') || (c == '*' && a->estado == ANALIZADOR_MNEMONICO && a->num_letras == 0)) {
+        if (a->num_letras < LARGO_MNEMONICO) {
+            a->letras[a->num_letras] = c;
+        }
+        if (a->num_letras < 255) {
+            a->num_letras++;
+        }
+        return false;
+    }
+    printf("Caracter invalido\n");
+    a->estado = ANALIZADOR_ERROR;
+    return false;
+}
+
+/**
+ * @brief Aplica un lote confirmado
+ *
+ * Si algun parametro del lote fue invalido no se aplica ninguno. Los cambios se copian con las interrupciones
+ * apagadas para que la interrupcion de disparo nunca vea una mezcla de configuracion vieja y nueva.
+ * Un lote que solo recupera un preset usa la tabla de la cache sin recalcular nada; si ademas cambia algun
+ * parametro se vuelve a calcular muestra a muestra. El guardado va al final, con el resultado del lote.
+ *
+ * @return true si se aplico algun cambio.
+ */
+bool aplicar_lote(analizador_t *a, configuracion_senal_t *config) {
+    if (a->estado == ANALIZADOR_ERROR) {
+        printf("Comando rechazado, no se aplico ningun cambio\n");
+        return false;
+    }
+    if (a->cambios == 0) {
+        return false;
+    }
+    configuracion_senal_t nueva = *config;
+    entrada_cache_t *entrada = NULL;
+    if (a->cambios & (1 << PARAM_RECUPERAR)) {
+        if (a->preset_recuperar >= NUM_PRESETS || !presets_guardados.ocupado[a->preset_recuperar]) {
+            printf("Preset %d vacio, no se aplico ningun cambio\n", a->preset_recuperar);
+            return false;
+        }
+        nueva = presets_guardados.presets[a->preset_recuperar];
+        entrada = cache_preset(a->preset_recuperar); //NULL para ruido: se genera muestra a muestra
+    }
+    if (a->cambios & (1 << PARAM_AMPLITUD)) nueva.amplitud = a->pendiente.amplitud;
+    if (a->cambios & (1 << PARAM_OFFSET)) nueva.offset = a->pendiente.offset;
+    if (a->cambios & (1 << PARAM_FRECUENCIA)) nueva.frecuencia = a->pendiente.frecuencia;
+    if (a->cambios & (1 << PARAM_FORMA)) nueva.tipo = a->pendiente.tipo;
+    if (a->cambios & (1 << PARAM_INTERPOLACION)) nueva.interpolacion = a->pendiente.interpolacion;
+    if (a->cambios & (1 << PARAM_DISPARO)) {
+        nueva.disparo = a->pendiente.disparo;
+        nueva.periodos = a->pendiente.periodos;
+    }
+    // La frecuencia y la interpolacion pueden venir en comandos distintos o de un preset: se revisan juntas
+    if (nueva.interpolacion != INTERP_NINGUNA && nueva.frecuencia >= FRECUENCIA_MAX_INTERP) {
+        printf("Frecuencia %d Hz fuera de rango con interpolacion (maximo %d Hz), no se aplico ningun cambio\n",
+            nueva.frecuencia, FRECUENCIA_MAX_INTERP - 1);
+        return false;
+    }
+
+    bool solo_preset = entrada != NULL && (a->cambios & ~((1 << PARAM_RECUPERAR) | (1 << PARAM_GUARDAR))) == 0;
+    const uint8_t *tabla = NULL;
+    uint32_t incremento;
+    uint8_t valor_fase_cero;
+    if (solo_preset) {
+        tabla = entrada->tabla;
+        incremento = entrada->incremento;
+        valor_fase_cero = tabla[0];
+    } else {
+        calcular_muestreo(nueva.frecuencia, nueva.interpolacion, &nueva.periodo_us, &incremento);
+        valor_fase_cero = calcular_muestra(nueva.tipo, nueva.amplitud, nueva.offset, 0);
+    }
+
+    uint32_t inicio_irq;
+    uint32_t estado_irq = entrar_seccion_critica(&inicio_irq);
+    *config = nueva;
+    tabla_escalada = tabla;
+    modo_interpolacion = nueva.interpolacion;
+    incremento_fase = incremento;
+    valor_inicio_disparo = valor_fase_cero;
+    if (a->cambios & ((1 << PARAM_DISPARO) | (1 << PARAM_RECUPERAR))) {
+        modo_disparo = nueva.disparo;
+        periodos_rafaga = nueva.periodos;
+        salida_activa = nueva.disparo == DISPARO_CONTINUO;
+    }
+    salir_seccion_critica(estado_irq, inicio_irq);
+    printf("Configuracion ingresada : Amplitud-> %d, Offset-> %d, Frecuencia-> %d, Forma-> %d, Interpolacion-> %d, Disparo-> %d\n",
+        nueva.amplitud, nueva.offset, nueva.frecuencia, nueva.tipo, nueva.interpolacion, nueva.disparo);
+
+    if (a->cambios & (1 << PARAM_GUARDAR)) {
+        guardar_preset(a->preset_guardar, &nueva);
+    }
+    return true;
+}
+
+#define MAX_CARACTERES_SERIE 16 // Caracteres por vuelta del ciclo, para no atrasar las muestras
+
 /**
  * @brief Ciclo principal
  */
@@ -242,20 +1205,42 @@ void asignar_pines() {
 void programa_principal() {
     // Inicialización de la entrada y salida estándar
     stdio_init_all();
+#ifdef SIMULACION_HOST
+    vcd_abrir(VCD_RUTA);
+#endif
     // Configuración de los dispositivos
     configurar();
     // Asignación de los pines del teclado
     asignar_pines();
+    // Configuración de la entrada de disparo
+    configurar_disparo();
+    // Generadores de ruido y costo por muestra de cada fuente
+    ruido_iniciar(&ruido_blanco, RUIDO_SEMILLA, false);
+    ruido_iniciar(&ruido_rosa, RUIDO_SEMILLA ^ time_us_32(), true);
+    medir_costo_fuentes();
     // Inicialización de variables
-    char texto_ingresado[20] = "";  // Inicializa la variable para almacenar el texto ingresado.
-    uint32_t amplitud = 1000; // Valor predeterminado para la amplitud de la señal.
-    uint32_t offset = 100; // Valor predeterminado para el offset de la señal.
-    uint32_t frecuencia = 10; // Valor predeterminado para la frecuencia de la señal.
+    configuracion_senal_t senal = {
+        .tipo = 0,
+        .amplitud = 1000, // Valor predeterminado para la amplitud de la señal.
+        .offset = 100, // Valor predeterminado para el offset de la señal.
+        .frecuencia = 10, // Valor predeterminado para la frecuencia de la señal.
+        .interpolacion = INTERP_NINGUNA,
+        .disparo = DISPARO_CONTINUO,
+        .periodos = 1,
+    };
+    calcular_muestreo(senal.frecuencia, senal.interpolacion, &senal.periodo_us, &incremento_fase);
+    cargar_presets();
+    analizador_t teclado; // Comandos del teclado matricial
+    analizador_t serie; // Comandos SCPI por el puerto serie
+    analizador_reiniciar(&teclado, &senal, ANALIZADOR_VALOR);
+    analizador_reiniciar(&serie, &senal, ANALIZADOR_MNEMONICO);
     uint32_t proxima_ejecucion = time_us_32() / 1000;  // Tiempo para la próxima ejecución del ciclo.
-    uint32_t puntos = 100;  // Número de puntos de la señal.
-    uint32_t frec_muestreo = (uint32_t)((1000000.0)*(1.0/puntos)*(1.0/frecuencia)); // Frecuencia de muestreo de la señal.
     uint32_t tiempo_muestreo = time_us_32(); // Tiempo de inicio del muestreo.
-    char tipo_senal[11] = " ";  // Tipo de señal generada.
+    bool latencia_pendiente = false; // Hay un comando aplicado esperando su primera muestra
+    uint32_t instante_comando = 0; // Tiempo en que se confirmo el ultimo comando
+    uint32_t latencia_comando_us = 0; // Ultima latencia comando -> salida
+    uint32_t latencia_comando_max_us = 0; // Peor latencia comando -> salida
+    char tipo_senal[13] = " ";  // Tipo de señal generada.
 
     // Bucle principal del programa
     while (true) {
@@ -267,41 +1252,13 @@ void programa_principal() {
                     int tiempo_actual = time_us_32() / 1000;
                     if (tiempo_actual - last_keypress_time > 500) {
                         char tecla_presionada = matrix_keys[fila][columna];
-                        if (tecla_presionada == 'D') { 
-                            if (texto_ingresado[0] == 'A') {
-                                uint32_t nueva_amplitud = atoi(&texto_ingresado[1]);
-                                if (100 <= nueva_amplitud && nueva_amplitud <= 2500) {
-                                    printf("Configuracion ingresada : Amplitud-> %d\n", nueva_amplitud);
-                                    amplitud = nueva_amplitud; // Generar señal con nueva amplitud
-                                } else {
-                                    printf("Configuracion de amplitud invalida\n");
-                                }
-                            } else if (texto_ingresado[0] == 'B') {
-                                uint32_t nuevo_offset = atoi(&texto_ingresado[1]);
-                                if (50 <= nuevo_offset && nuevo_offset <= 1250) {
-                                    printf("Configuracion ingresada : Offset-> %d\n", nuevo_offset);
-                                    offset = nuevo_offset; // Generar señal con nuevo offset
-                                } else {
-                                    printf("Configuracion de offset invalida\n");
-                                }
-                            } else if (texto_ingresado[0] == 'C') {
-                                uint32_t nueva_frecuencia = atoi(&texto_ingresado[1]);
-                                if (1 <= nueva_frecuencia && nueva_frecuencia <= 12000000) {
-                                    printf("Configuracion ingresada : Frecuencia-> %d\n", nueva_frecuencia);
-                                    frecuencia = nueva_frecuencia; // Generar señal con nueva frecuencia
-                                    frec_muestreo = (uint32_t)((1000000.0)*(1.0/puntos)*(1.0/frecuencia)); // Se calcula la nueva frecuencia de muestreo
-                                } else {
-                                    printf("Configuracion de frecuencia invalida\n");
-                                }
-                            }
-                            printf("Texto ingresado: %s\n", texto_ingresado);
-                            texto_ingresado[0] = '\0';  
-                        } else {
-                            strncat(texto_ingresado, &tecla_presionada, 1);
-                            if (strlen(texto_ingresado) >= 10) { 
-                                printf("Texto demasiado largo. Presione 'D' para finalizar.\n");
-                                texto_ingresado[0] = '\0';  
+                        if (analizador_tecla(&teclado, tecla_presionada)) {
+                            uint32_t confirmado = time_us_32();
+                            if (aplicar_lote(&teclado, &senal)) {
+                                instante_comando = confirmado;
+                                latencia_pendiente = true;
                             }
+                            analizador_reiniciar(&teclado, &senal, ANALIZADOR_VALOR);
                         }
                         last_keypress_time = tiempo_actual;
                     }
@@ -310,35 +1267,100 @@ void programa_principal() {
             }
         }
 
+        // Verificar si llegaron comandos por el puerto serie
+        for (int n = 0; n < MAX_CARACTERES_SERIE; n++) {
+            int c = getchar_timeout_us(0);
+            if (c == PICO_ERROR_TIMEOUT) {
+                break;
+            }
+            if (analizador_caracter(&serie, (char)c)) {
+                uint32_t confirmado = time_us_32();
+                if (aplicar_lote(&serie, &senal)) {
+                    instante_comando = confirmado;
+                    latencia_pendiente = true;
+                }
+                analizador_reiniciar(&serie, &senal, ANALIZADOR_MNEMONICO);
+            }
+        }
+
         // Lógica para procesar el botón 
         if (gpio_get(Boton_pin) == 1) {
             int tiempo_actual = time_us_32() / 1000;
             if (tiempo_actual - last_button_press > 300) {
-                count = (count + 1) % 4; 
+                uint32_t inicio_irq;
+                uint32_t estado_irq = entrar_seccion_critica(&inicio_irq);
+                senal.tipo = (senal.tipo + 1) % NUM_FORMAS; 
+                tabla_escalada = NULL; //La tabla del preset ya no corresponde
+                salir_seccion_critica(estado_irq, inicio_irq);
                 last_button_press = tiempo_actual;
             }
         }
 
         // Lógica para generar la señal
-        if ((time_us_32() - tiempo_muestreo) > frec_muestreo) {
-            generador(count, amplitud, offset);
-            tiempo_muestreo = time_us_32();
+        // La interrupcion de disparo lee valor_inicio_disparo y toca la fase, por eso la muestra va con las interrupciones apagadas
+        const uint8_t *tabla = tabla_escalada;
+        uint8_t valor_fase_cero = tabla ? tabla[0] : calcular_muestra(senal.tipo, senal.amplitud, senal.offset, 0);
+        uint32_t inicio_irq;
+        uint32_t estado_irq = entrar_seccion_critica(&inicio_irq);
+        valor_inicio_disparo = valor_fase_cero;
+        if (disparo_pendiente) {
+            tiempo_muestreo = instante_disparo_us;
+            disparo_pendiente = false;
+        }
+        if (latencia_pendiente && !salida_activa) {
+            // Sin salida (compuerta cerrada o esperando rafaga) no hay muestra que medir; la espera del disparo
+            // no es latencia del comando
+            latencia_pendiente = false;
         }
+        // Las muestras van en una grilla fija tiempo_muestreo + k * periodo, asi el incremento de fase calculado para
+        // ese periodo da la frecuencia exacta. Si el ciclo se atraso varias muestras se saltan en la fase y solo
+        // sale la mas reciente.
+        uint32_t atraso = time_us_32() - tiempo_muestreo;
+        if (salida_activa && atraso >= senal.periodo_us) {
+            uint32_t muestras = senal.periodo_us ? atraso / senal.periodo_us : 1;
+            if (muestras > 1) {
+                avanzar_fase((uint64_t)(muestras - 1) * incremento_fase);
+            }
+            if (salida_activa) {
+                generador_senal(senal.tipo, senal.amplitud, senal.offset);
+            }
+            tiempo_muestreo = senal.periodo_us ? tiempo_muestreo + muestras * senal.periodo_us : time_us_32();
+            if (latencia_pendiente) {
+                latencia_comando_us = time_us_32() - instante_comando;
+                if (latencia_comando_us > latencia_comando_max_us) {
+                    latencia_comando_max_us = latencia_comando_us;
+                }
+                latencia_pendiente = false;
+            }
+        }
+        salir_seccion_critica(estado_irq, inicio_irq);
 
         //Logica para imprimir por serial el estado de la señal
         uint32_t tiempo_actual = time_us_32()/1000;
         if (tiempo_actual - proxima_ejecucion >= 1000) {
-            if (count==0) {
+            if (senal.tipo==0) {
                 strcpy(tipo_senal, "Seno");
-            } else if (count==1){
+            } else if (senal.tipo==1){
                 strcpy(tipo_senal, "Triangular");
-            } else if (count==2){
+            } else if (senal.tipo==2){
                strcpy(tipo_senal, "Sierra");
-            } else if (count==3){
+            } else if (senal.tipo==3){
                 strcpy(tipo_senal, "Cuadrada");
+            } else if (senal.tipo==FORMA_RUIDO_BLANCO){
+                strcpy(tipo_senal, "Ruido blanco");
+            } else if (senal.tipo==FORMA_RUIDO_ROSA){
+                strcpy(tipo_senal, "Ruido rosa");
+            }
+             printf("Señal: Tipo -> %s, Amplitud -> %d mV, Offset -> %d mV, Frecuencia -> %d Hz, Interpolacion -> %d\n",
+                tipo_senal, senal.amplitud, senal.offset, senal.frecuencia, senal.interpolacion);
+            printf("Comando -> salida: Latencia -> %d us, Maxima -> %d us\n", latencia_comando_us, latencia_comando_max_us);
+            if (modo_disparo != DISPARO_CONTINUO) {
+                uint32_t ciclos_por_us = clock_get_hz(clk_sys) / 1000000;
+                printf("Disparo: Modo -> %d, Periodos -> %d, Flanco -> muestra %d ciclos (%d us), Maxima -> %d ciclos (%d us), Sin medir -> %d\n",
+                    modo_disparo, periodos_rafaga, latencia_disparo_ciclos, latencia_disparo_ciclos / ciclos_por_us,
+                    latencia_disparo_max_ciclos, latencia_disparo_max_ciclos / ciclos_por_us, disparos_sin_medir);
+                printf("Disparo: Seccion critica mas larga -> %d us (se suma a la latencia en el peor caso)\n", peor_irq_apagadas_us);
             }
-             printf("Señal: Tipo -> %s, Amplitud -> %d mV, Offset -> %d mV, Frecuencia -> %d Hz\n",
-                tipo_senal, amplitud, offset, frecuencia);
             proxima_e
 
     }
@@ -5,6 +5,14 @@
 #include "hardware/gpio.h"
 #include "math.h"
 #include "pico/time.h"
+#include "ruido.h"
+
+#ifdef SIMULACION_HOST
+// En el backend de simulacion cada cambio de nivel del PWM queda en un archivo VCD
+#include "vcd_trace.h"
+#define VCD_RUTA "generador_pwm.vcd"
+#define pwm_set_chan_level(slice, canal, nivel) do { pwm_set_chan_level((slice), (canal), (nivel)); vcd_pwm((nivel)); } while (0)
+#endif
 
 #define PWM_PIN 2 // Pin PWM
 
@@ -53,9 +61,25 @@ void generate_sine_wave() {
     }
 }
 
+void generate_noise_wave(bool rosa) {
+    uint8_t bloque[64]; // Se genera por bloques y se saca muestra a muestra
+    ruido_t ruido;
+    ruido_iniciar(&ruido, RUIDO_SEMILLA, rosa);
+    for (int i = 0; i < 1024; i += sizeof(bloque)) {
+        ruido_bloque(&ruido, bloque, sizeof(bloque));
+        for (size_t k = 0; k < sizeof(bloque); k++) {
+            set_pwm_duty_cycle((uint16_t)bloque[k] << 2); // 8 bits a la escala de 0 a 1023
+            sleep_ms(10);
+        }
+    }
+}
+
 int main() {
     stdio_init_all();
     sleep_ms(2000); // Espera para establecer una conexión serial
+#ifdef SIMULACION_HOST
+    vcd_abrir(VCD_RUTA);
+#endif
 
     pwm_init();
 
@@ -75,6 +99,14 @@ int main() {
         printf("Generando señal senoidal...\n");
         generate_sine_wave();
         sleep_ms(2000); // Espera entre señales
+
+        printf("Generando ruido blanco...\n");
+        generate_noise_wave(false);
+        sleep_ms(2000); // Espera entre señales
+
+        printf("Generando ruido rosa...\n");
+        generate_noise_wave(true);
+        sleep_ms(2000); // Espera entre señales
     }
 
     return 0;
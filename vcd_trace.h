@@ -0,0 +1,261 @@
+/**
+ * \file Signal wave generator - VCD trace for host simulation
+ * \Brief description of the code
+ * \Value Change Dump writer used when the generator is built for a host simulation backend (SIMULACION_HOST).
+ *\Every GPIO write, DAC byte and PWM level change is written with its virtual timestamp so the waveforms can be opened in GTKWave
+ * \author      José Alejandro Moreno Mesa (jose.morenom@udea.edu.co)
+ * \version     0.0.1
+ * \date        18/10/2026
+ * \copyright   Unlicensed
+ */
+
+#ifndef VCD_TRACE_H
+#define VCD_TRACE_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <signal.h>
+
+/**
+ * @brief Parámetros del trazado
+ *
+ * El reloj virtual va en ns. Cada escritura de GPIO lo avanza VCD_COSTE_GPIO_PUT_NS (una escritura SIO del
+ * RP2040 a 125 MHz), así el desfase entre los ocho gpio_put de set_DAC_value se ve en la traza.
+ *
+ * Las líneas se acumulan en un buffer de VCD_TAM_BUFFER bytes que se escribe al archivo de a bloques, por lo que
+ * cada transición cuesta unas pocas decenas de instrucciones y ninguna llamada a printf. El buffer también se
+ * vacía cada VCD_PERIODO_VACIADO_NS de tiempo virtual, así que al cortar la simulación se pierde a lo sumo ese
+ * tramo aunque no se alcance a cerrar la traza.
+ *
+ * Contrato con el backend de simulación (los bucles del firmware nunca retornan):
+ *  - Todo el tiempo que pasa fuera de gpio_put (sleep_us, busy_wait, esperas de time_us_32, __wfi) se avanza
+ *    con vcd_avanzar_ns. Es lo único que mueve el reloj además de vcd_gpio.
+ *  - time_us_32 devuelve (uint32_t)vcd_tiempo_us() y time_us_64 devuelve vcd_tiempo_us(); ningún otro reloj.
+ *  - Para terminar se llama vcd_cerrar (o exit, que la corre por atexit). vcd_abrir instala un manejador de
+ *    SIGINT y SIGTERM que solo marca la parada; el siguiente vcd_avanzar_ns cierra la traza y sale. Con
+ *    VCD_SIN_SENALES definido no se instala y el backend se encarga de las señales.
+ */
+#ifndef VCD_COSTE_GPIO_PUT_NS
+#define VCD_COSTE_GPIO_PUT_NS 16
+#endif
+#ifndef VCD_TAM_BUFFER
+#define VCD_TAM_BUFFER (1 << 16)
+#endif
+#ifndef VCD_PERIODO_VACIADO_NS
+#define VCD_PERIODO_VACIADO_NS 10000000ull // 10 ms virtuales
+#endif
+#define VCD_MAX_LINEA 48 // Línea más larga posible: "#" + 20 dígitos o "b" + 16 bits + " " + id
+#define VCD_NUM_GPIO 30
+
+// Identificadores VCD: GPIO n -> '!' + n, bus del DAC -> '{', nivel PWM -> '}'
+#define VCD_ID_GPIO(n) ((char)('!' + (n)))
+#define VCD_ID_DAC '{'
+#define VCD_ID_PWM '}'
+
+static FILE *vcd_archivo = NULL;
+static char vcd_buffer[VCD_TAM_BUFFER];
+static size_t vcd_usado = 0;
+static uint64_t vcd_ahora_ns = 0; // Reloj virtual
+static uint64_t vcd_ultimo_ns = UINT64_MAX; // Último timestamp escrito
+static uint64_t vcd_vaciado_ns = 0; // Reloj virtual del último vaciado
+static volatile sig_atomic_t vcd_detener = 0; // Lo pone el manejador de señales
+static int8_t vcd_gpio_nivel[VCD_NUM_GPIO]; // -1 = desconocido
+static int32_t vcd_dac_valor = -1;
+static int32_t vcd_pwm_valor = -1;
+
+/**
+ * @brief Escribe el buffer al archivo y lo pasa al sistema operativo
+ *
+ * El backend puede llamarla en cualquier momento fuera de un manejador de señales.
+ */
+static void vcd_vaciar(void) {
+    if (vcd_archivo && vcd_usado) {
+        fwrite(vcd_buffer, 1, vcd_usado, vcd_archivo);
+        fflush(vcd_archivo);
+    }
+    vcd_usado = 0;
+    vcd_vaciado_ns = vcd_ahora_ns;
+}
+
+static inline void vcd_texto(const char *texto) {
+    while (*texto) {
+        vcd_buffer[vcd_usado++] = *texto++;
+    }
+}
+
+static inline void vcd_decimal(uint64_t valor) {
+    char digitos[20];
+    int n = 0;
+    do {
+        digitos[n++] = (char)('0' + valor % 10);
+        valor /= 10;
+    } while (valor);
+    while (n) {
+        vcd_buffer[vcd_usado++] = digitos[--n];
+    }
+}
+
+/**
+ * @brief Deja espacio para una línea y escribe el timestamp si el reloj avanzó
+ */
+static inline void vcd_preparar(void) {
+    if (vcd_usado > VCD_TAM_BUFFER - 2 * VCD_MAX_LINEA) {
+        vcd_vaciar();
+    }
+    if (vcd_ahora_ns != vcd_ultimo_ns) {
+        vcd_buffer[vcd_usado++] = '#';
+        vcd_decimal(vcd_ahora_ns);
+        vcd_buffer[vcd_usado++] = '\n';
+        vcd_ultimo_ns = vcd_ahora_ns;
+    }
+}
+
+static inline void vcd_vector(uint32_t valor, int bits, char id) {
+    vcd_buffer[vcd_usado++] = 'b';
+    for (int i = bits - 1; i >= 0; i--) {
+        vcd_buffer[vcd_usado++] = (char)('0' + ((valor >> i) & 1));
+    }
+    vcd_buffer[vcd_usado++] = ' ';
+    vcd_buffer[vcd_usado++] = id;
+    vcd_buffer[vcd_usado++] = '\n';
+}
+
+/**
+ * @brief Cierra la traza
+ *
+ * Se registra con atexit en vcd_abrir; el backend también puede llamarla al terminar la simulación.
+ * Llamarla dos veces no hace nada.
+ */
+static void vcd_cerrar(void) {
+    if (!vcd_archivo) {
+        return;
+    }
+    vcd_preparar();
+    vcd_vaciar();
+    fclose(vcd_archivo);
+    vcd_archivo = NULL;
+}
+
+/**
+ * @brief Manejador de SIGINT/SIGTERM
+ *
+ * Solo marca la parada: fwrite y fclose no se pueden llamar desde una señal.
+ */
+static void vcd_senal(int senal) {
+    (void)senal;
+    vcd_detener = 1;
+}
+
+/**
+ * @brief Abre el archivo VCD y escribe la cabecera
+ *
+ * @param ruta: Archivo de salida.
+ * @return true si se pudo abrir.
+ */
+static bool vcd_abrir(const char *ruta) {
+    vcd_archivo = fopen(ruta, "wb");
+    if (!vcd_archivo) {
+        return false;
+    }
+    vcd_usado = 0;
+    vcd_ahora_ns = 0;
+    vcd_ultimo_ns = UINT64_MAX;
+    vcd_texto("$timescale 1ns $end\n$scope module generador $end\n");
+    for (int pin = 0; pin < VCD_NUM_GPIO; pin++) {
+        vcd_texto("$var wire 1 ");
+        vcd_buffer[vcd_usado++] = VCD_ID_GPIO(pin);
+        vcd_texto(" gpio");
+        vcd_decimal(pin);
+        vcd_texto(" $end\n");
+        vcd_gpio_nivel[pin] = -1;
+    }
+    vcd_texto("$var wire 8 { dac [7:0] $end\n$var wire 16 } pwm_nivel [15:0] $end\n");
+    vcd_texto("$upscope $end\n$enddefinitions $end\n#0\n$dumpvars\n");
+    for (int pin = 0; pin < VCD_NUM_GPIO; pin++) {
+        vcd_buffer[vcd_usado++] = 'x';
+        vcd_buffer[vcd_usado++] = VCD_ID_GPIO(pin);
+        vcd_buffer[vcd_usado++] = '\n';
+        if (vcd_usado > VCD_TAM_BUFFER - 2 * VCD_MAX_LINEA) {
+            vcd_vaciar();
+        }
+    }
+    vcd_texto("bx {\nbx }\n$end\n");
+    vcd_ultimo_ns = 0;
+    vcd_vaciado_ns = 0;
+    vcd_dac_valor = -1;
+    vcd_pwm_valor = -1;
+    atexit(vcd_cerrar);
+#ifndef VCD_SIN_SENALES
+    signal(SIGINT, vcd_senal);
+    signal(SIGTERM, vcd_senal);
+#endif
+    return true;
+}
+
+/**
+ * @brief Reloj virtual
+ *
+ * Además de avanzar el reloj vacía el buffer cada VCD_PERIODO_VACIADO_NS y, si llegó SIGINT o SIGTERM,
+ * cierra la traza y termina el proceso.
+ */
+static inline void vcd_avanzar_ns(uint64_t ns) {
+    vcd_ahora_ns += ns;
+    if (vcd_detener) {
+        exit(0); // vcd_cerrar corre por atexit
+    }
+    if (vcd_ahora_ns - vcd_vaciado_ns >= VCD_PERIODO_VACIADO_NS) {
+        vcd_vaciar();
+    }
+}
+
+static inline uint64_t vcd_tiempo_ns(void) {
+    return vcd_ahora_ns;
+}
+
+static inline uint64_t vcd_tiempo_us(void) {
+    return vcd_ahora_ns / 1000;
+}
+
+/**
+ * @brief Registra una escritura de GPIO y avanza el reloj el costo de la escritura
+ *
+ * @param pin: GPIO escrito.
+ * @param valor: Cualquier valor distinto de cero es nivel alto, igual que gpio_put.
+ */
+static inline void vcd_gpio(unsigned pin, uint32_t valor) {
+    int8_t nivel = valor ? 1 : 0;
+    if (vcd_archivo && pin < VCD_NUM_GPIO && vcd_gpio_nivel[pin] != nivel) {
+        vcd_preparar();
+        vcd_buffer[vcd_usado++] = (char)('0' + nivel);
+        vcd_buffer[vcd_usado++] = VCD_ID_GPIO(pin);
+        vcd_buffer[vcd_usado++] = '\n';
+        vcd_gpio_nivel[pin] = nivel;
+    }
+    vcd_ahora_ns += VCD_COSTE_GPIO_PUT_NS;
+}
+
+/**
+ * @brief Registra el byte que se pidió al DAC (antes de que salgan los bits uno por uno)
+ */
+static inline void vcd_dac(uint8_t valor) {
+    if (vcd_archivo && vcd_dac_valor != valor) {
+        vcd_preparar();
+        vcd_vector(valor, 8, VCD_ID_DAC);
+        vcd_dac_valor = valor;
+    }
+}
+
+/**
+ * @brief Registra un cambio de nivel del PWM
+ */
+static inline void vcd_pwm(uint16_t nivel) {
+    if (vcd_archivo && vcd_pwm_valor != nivel) {
+        vcd_preparar();
+        vcd_vector(nivel, 16, VCD_ID_PWM);
+        vcd_pwm_valor = nivel;
+    }
+}
+
+#endif // VCD_TRACE_H